@@ -7,34 +7,145 @@
 // Include the EEPROM library to read and write to the Arduino's non-volatile memory (EEPROM)
 #include <EEPROM.h>
 
+// Size of the receive ring buffer for data coming from the GSM module (must be a power of two)
+// The core's 64-byte buffer is too small to hold a full "AT+CMGR" response or a burst of URCs
+#define RX_BUFFER_SIZE 256
+
+// Set to 1 to use RTS/CTS hardware flow control between the Arduino and the GSM module
+#define USE_FLOW_CONTROL 0
+
+// RTS is an output (LOW = Arduino ready to receive), CTS is an input (LOW = module ready to receive)
+#define rts_pin 2
+#define cts_pin 3
+
+// Ask the module to pause when the buffer is this full, and let it resume once it drains below RX_LOW_WATER
+#define RX_HIGH_WATER (RX_BUFFER_SIZE - 32)
+#define RX_LOW_WATER (RX_BUFFER_SIZE / 4)
+
+// The buffer positions wrap with "& (RX_BUFFER_SIZE - 1)" and the watermarks need room, so check the size here
+#if (RX_BUFFER_SIZE & (RX_BUFFER_SIZE - 1)) || RX_BUFFER_SIZE < 64
+#error "RX_BUFFER_SIZE must be a power of two and at least 64"
+#endif
+
+// Longest time in milliseconds modem_write() waits for CTS before sending the byte anyway
+#define CTS_TIMEOUT 100
+
+// Time in milliseconds with no incoming byte after which modem_read_string() returns (same as Serial.readString())
+#define RX_TIMEOUT 1000
+
+// Time in milliseconds with no incoming byte that ends a read in check_status_sms(), enough for one URC line
+#define URC_TIMEOUT 100
+
+// Longest time in milliseconds check_status_sms() waits for the reply to AT+CMGR
+#define CMGR_TIMEOUT 5000
+
+// Number of times AT+IFC=2,2 is sent before giving up on hardware flow control
+#define IFC_RETRIES 5
+
+// ATmega328P boards name the receive interrupt USART_RX_vect, boards with several UARTs use USART0_RX_vect
+#if defined(USART_RX_vect)
+#define MODEM_RX_vect USART_RX_vect
+#else
+#define MODEM_RX_vect USART0_RX_vect
+#endif
+
+// Receive ring buffer filled by the UART interrupt and emptied by modem_read()
+// The built-in Serial object is not used because its own interrupt would clash with this one
+volatile uint8_t rx_buffer[RX_BUFFER_SIZE];
+volatile uint16_t rx_head = 0; // Position where the interrupt stores the next byte
+volatile uint16_t rx_tail = 0; // Position where modem_read() takes the next byte
+
+// Diagnostic counters, reported by rx_stats() and the "ST" SMS command
+volatile unsigned long rx_overflow_count = 0; // Number of times the ring buffer ran full
+volatile unsigned long rx_dropped_bytes = 0; // Number of bytes thrown away because the buffer was full
+volatile unsigned long rx_hw_overrun_events = 0; // Number of UART data overruns, each losing at least one byte before the interrupt ran
+volatile bool rx_overflowed = false; // True while the buffer is full, so one overflow is counted only once
+volatile bool rx_paused = false; // True while RTS tells the module to stop sending
+bool tx_flow_enabled = false; // True once the module has accepted AT+IFC=2,2, only then modem_write() waits for CTS
+unsigned long tx_cts_timeouts = 0; // Number of times CTS stayed HIGH longer than CTS_TIMEOUT
+bool tx_cts_stalled = false; // True after a CTS timeout, modem_write() then sends without waiting until CTS is seen LOW again
+bool tx_written = false; // True once a byte has been sent, so modem_flush() has something to wait for
+
+
+int rx_count() {
+  // Number of bytes waiting in the ring buffer (called with interrupts disabled)
+  return (rx_head - rx_tail) & (RX_BUFFER_SIZE - 1);
+}
+
+
+// Runs for every byte received from the GSM module, even while the program sits in delay()
+// The core's HardwareSerial0.cpp defines the same vector, so any reference to Serial in this sketch
+// links that file in and fails with a duplicate USART_RX_vect: use the modem_* functions instead
+ISR(MODEM_RX_vect) {
+  uint8_t status = UCSR0A; // Read the status before the data, reading UDR0 clears the error flags
+  uint8_t c = UDR0; // Take the received byte out of the UART
+  uint16_t next = (rx_head + 1) & (RX_BUFFER_SIZE - 1); // Next write position in the ring buffer
+
+  // Count UART overrun events, each means at least one byte was lost because the previous one was not read in time
+  if (status & _BV(DOR0))
+    rx_hw_overrun_events++;
+
+  if (next == rx_tail) {
+    // The buffer is full: drop the byte and count the overflow once per full episode
+    rx_dropped_bytes++;
+    if (!rx_overflowed) {
+      rx_overflow_count++;
+      rx_overflowed = true;
+    }
+  } else {
+    rx_buffer[rx_head] = c; // Store the byte
+    rx_head = next;
+    rx_overflowed = false;
+  }
+
+#if USE_FLOW_CONTROL
+  // Tell the module to stop sending before the buffer runs full
+  if (!rx_paused && rx_count() >= RX_HIGH_WATER) {
+    digitalWrite(rts_pin, HIGH);
+    rx_paused = true;
+  }
+#endif
+}
+
 
 void setup() {
   int i = 0; // Initialize a counter variable
 
-  // Start serial communication with a baud rate of 115200
-  Serial.begin(115200);
+  // Start serial communication with the GSM module with a baud rate of 115200
+  modem_begin(115200);
 
   // Call a function to check and establish GSM network connectivity
   check_connect();
 
+#if USE_FLOW_CONTROL
+  // Enable RTS/CTS hardware flow control on the GSM module now that it answers commands
+  // Retry until it replies OK, modem_write() waits for CTS only after that
+  for (int tries = 0; tries < IFC_RETRIES && !tx_flow_enabled; tries++) {
+    modem_print("AT+IFC=2,2\r\n");
+    delay(1000);
+    if (modem_read_string().indexOf("OK") >= 0)
+      tx_flow_enabled = true;
+  }
+#endif
+
   // Configure GSM module to operate in SMS text mode
-  Serial.print("AT+CMGF=1\r\n");
+  modem_print("AT+CMGF=1\r\n");
   delay(1000); // Wait for 1 second to ensure the command takes effect
 
   // Delete all SMS messages stored in the GSM module
-  Serial.print("AT+CMGD=1,4\r\n");
+  modem_print("AT+CMGD=1,4\r\n");
   delay(1000);
 
   // Set SMS parameters (e.g., PDU mode, validity period)
-  Serial.print("AT+CSMP=17,167,0,0\r\n");
+  modem_print("AT+CSMP=17,167,0,0\r\n");
   delay(1000);
 
   // Enable caller line identification (display incoming call numbers)
-  Serial.print("AT+CLIP=1\r\n");
+  modem_print("AT+CLIP=1\r\n");
   delay(1000);
 
   // Clear any residual data from the serial buffer
-  Serial.readString();
+  modem_read_string();
 
   // Wait until at least one phone number is saved in EEPROM
   // Numbers are stored at addresses 0 and 20 in EEPROM
@@ -67,10 +178,10 @@ void setup() {
     delay(1000); // Delay for 1 second (300 seconds = 5 minutes)
 
   // Print a message to the serial monitor indicating that monitoring has started
-  Serial.println("MONITORING");
+  modem_println("MONITORING");
 
   // Flush the serial buffer to ensure no residual data remains
-  Serial.flush();
+  modem_flush();
 }
 
 
@@ -85,6 +196,9 @@ void loop() {
     // Check for any incoming calls within a specific time frame
     // This allows the user to interact with the system if needed
     check_incoming_call();
+  } else {
+    // Answer the "ST" status command only while there is no gas alarm
+    check_status_sms();
   }
 }
 
@@ -93,25 +207,25 @@ void check_connect() {
   String status_ = ""; // String to store the network status response
 
   // Inform the user that the system is waiting to connect to the GSM network
-  Serial.println("WAITING TO CONNECT TO NETWORK");
+  modem_println("WAITING TO CONNECT TO NETWORK");
 
   // Clear any residual data in the serial buffer to ensure clean communication
-  Serial.flush();
+  modem_flush();
 
   // Continuously check for network connectivity
   while (true) {
     // If there's any data in the serial buffer, read and discard it
-    if (Serial.available() > 0)
-      Serial.readString();
+    if (modem_available() > 0)
+      modem_read_string();
 
     // Send an AT command to check the network registration status
-    Serial.print("AT+CCALR?\r\n");
+    modem_print("AT+CCALR?\r\n");
 
     // Wait for the GSM module to respond
     delay(1000);
 
     // Read the response from the GSM module
-    status_ = Serial.readString();
+    status_ = modem_read_string();
 
     // Check if the response indicates that the module is registered on the network
     // "+CCALR: 1" signifies successful network registration
@@ -120,10 +234,10 @@ void check_connect() {
   }
 
   // Print a message indicating successful network connection
-  Serial.println("CONNECTED TO NETWORK");
+  modem_println("CONNECTED TO NETWORK");
 
   // Clear the serial buffer again to ensure no residual data remains
-  Serial.flush();
+  modem_flush();
 }
 
 
@@ -131,39 +245,73 @@ void check_sms() {
   String get_sms = ""; // Variable to store the received SMS content
 
   // Check if there is data available in the serial buffer
-  if (Serial.available() > 0)
-    get_sms = Serial.readString(); // Read the incoming serial data into the string
+  if (modem_available() > 0)
+    get_sms = modem_read_string(); // Read the incoming serial data into the string
 
   // Check if the received data contains an SMS notification (+CMTI)
   if (get_sms.indexOf("+CMTI") >= 0) {
     // Clear any additional data in the serial buffer
-    if (Serial.available() > 0)
-      Serial.readString();
+    if (modem_available() > 0)
+      modem_read_string();
 
     // Send an AT command to read the first SMS in the inbox
-    Serial.print("AT+CMGR=1\r\n");
+    modem_print("AT+CMGR=1\r\n");
 
     // Wait until a response is received from the GSM module
-    while (Serial.available() == 0) {}
+    while (modem_available() == 0) {}
 
     // Read the SMS content from the serial buffer
-    get_sms = Serial.readString();
+    get_sms = modem_read_string();
 
     // Extract the actual message content from the SMS using delimiters '!' and '#'
     get_sms = get_sms.substring(get_sms.indexOf("!") + 1, get_sms.indexOf("#"));
 
     // Send an AT command to delete all SMS messages in the inbox to free memory
-    Serial.print("AT+CMGD=1,4\r\n");
+    modem_print("AT+CMGD=1,4\r\n");
     delay(1000);
 
     // Check if the SMS content is a delete command ("D1" or "D2")
     if (get_sms == "D1" || get_sms == "D2")
       delete_number(get_sms); // Delete the corresponding number from EEPROM
+    else if (get_sms == "ST")
+      send_sms(rx_stats()); // Reply with the serial receive counters if the content is the status command
     else if (get_sms != "")
       save_number(get_sms); // Save the new number to EEPROM if the content is valid
   }
 }
 
+void check_status_sms() {
+  String get_sms = ""; // Variable to store the received SMS content
+  unsigned long tm; // Time the AT+CMGR command was sent
+
+  // Return at once if the GSM module has sent nothing, so the gas sensor is checked again without delay
+  if (modem_available() == 0)
+    return;
+
+  // Read the waiting data and ignore everything except an SMS notification (+CMTI)
+  get_sms = modem_read_until_idle(URC_TIMEOUT);
+  if (get_sms.indexOf("+CMTI") < 0)
+    return;
+
+  // Send an AT command to read the first SMS in the inbox
+  modem_print("AT+CMGR=1\r\n");
+
+  // Wait for the response, but never longer than CMGR_TIMEOUT
+  tm = millis();
+  while (modem_available() == 0 && millis() - tm < CMGR_TIMEOUT) {}
+
+  // Read the SMS and extract the message content between '!' and '#'
+  get_sms = modem_read_until_idle(URC_TIMEOUT);
+  get_sms = get_sms.substring(get_sms.indexOf("!") + 1, get_sms.indexOf("#"));
+
+  // Send an AT command to delete all SMS messages in the inbox to free memory
+  modem_print("AT+CMGD=1,4\r\n");
+
+  // Only the status command is answered while monitoring, the stored numbers can be changed only at boot
+  if (get_sms == "ST")
+    send_sms(rx_stats());
+}
+
 void save_number(String number) {
   int i = 0; // Index variable for EEPROM address
   int j = 0; // Index variable for character array
@@ -202,11 +350,11 @@ void send_sms(String text) {
   if (char(EEPROM.read(0)) != NULL) {
     number = read_number(0); // Read the phone number from the first slot (starting at address 0)
     cmgs = cmgs + number + "\"\r\n"; // Complete the SMS command with the phone number
-    Serial.print(cmgs); // Send the command to the GSM module
+    modem_print(cmgs); // Send the command to the GSM module
     delay(500); // Wait for the module to process the command
-    Serial.println(text); // Send the SMS content
+    modem_println(text); // Send the SMS content
     delay(500); // Allow time for the content to be transmitted
-    Serial.write(0x1a); // Send the CTRL+Z (0x1A) character to indicate end of SMS
+    modem_write(0x1a); // Send the CTRL+Z (0x1A) character to indicate end of SMS
     delay(15000); // Wait for the SMS to be sent successfully
   }
   // If the first EEPROM slot is empty, check the second slot
@@ -214,10 +362,10 @@ void send_sms(String text) {
     cmgs = "AT+CMGS=\""; // Reset the base SMS command
     number = read_number(20); // Read the phone number from the second slot (starting at address 20)
     cmgs = cmgs + number + "\"\r\n"; // Complete the SMS command with the phone number
-    Serial.print(cmgs); // Send the command to the GSM module
+    modem_print(cmgs); // Send the command to the GSM module
     delay(500); // Wait for the module to process the command
-    Serial.println(text); // Send the SMS content
-    Serial.write(0x1a); // Send the CTRL+Z (0x1A) character to indicate end of SMS
+    modem_println(text); // Send the SMS content
+    modem_write(0x1a); // Send the CTRL+Z (0x1A) character to indicate end of SMS
   }
 }
 
@@ -261,14 +409,14 @@ void call_user() {
   // Check if a phone number is stored in the first EEPROM slot
   if (EEPROM.read(0) != NULL) {
     number = number + read_number(0) + ";\r\n"; // Append the stored phone number and terminate the command
-    Serial.print(number); // Send the AT command to the GSM module to initiate the call
+    modem_print(number); // Send the AT command to the GSM module to initiate the call
     delay(20000); // Wait for 20 seconds to allow the call to ring
   }
 
   // Check if a phone number is stored in the second EEPROM slot
   if (EEPROM.read(20) != NULL) {
     number = "ATD" + read_number(20) + ";\r\n"; // Append the second stored phone number and terminate the command
-    Serial.print(number); // Send the AT command to the GSM module to initiate the call
+    modem_print(number); // Send the AT command to the GSM module to initiate the call
     delay(20000); // Wait for 20 seconds to allow the call to ring
   }
 }
@@ -281,8 +429,8 @@ void check_incoming_call() {
   // Loop for a maximum duration of 60 seconds to check for incoming calls
   while (millis() - tm < 60000) {
     // Check if there is any data available from the GSM module
-    if (Serial.available() > 0) {
-      incoming_number = Serial.readString(); // Read the incoming data
+    if (modem_available() > 0) {
+      incoming_number = modem_read_string(); // Read the incoming data
     }
 
     // Check if the incoming data indicates an incoming call ("RING")
@@ -298,8 +446,171 @@ void check_number(String data_to_parse) {
 
   // Check if the extracted phone number matches either of the stored numbers in EEPROM
   if (data_to_parse == read_number(0) || data_to_parse == read_number(20)) {
-    Serial.print("ATH\r\n"); // Send the "ATH" command to hang up the call
+    modem_print("ATH\r\n"); // Send the "ATH" command to hang up the call
     delay(500); // Wait for a short duration to ensure the command is processed
     wdt_enable(WDTO_4S); // Enable the Watchdog Timer with a timeout of 4 seconds for a system reset
   }
 }
+
+
+void modem_begin(unsigned long baud) {
+  // Calculate the baud rate setting for double speed mode, rounded like the Arduino core does
+  uint16_t baud_setting = (F_CPU / 4 / baud - 1) / 2;
+
+#if USE_FLOW_CONTROL
+  // RTS starts LOW so the module may send, CTS is read before every byte we send
+  pinMode(rts_pin, OUTPUT);
+  digitalWrite(rts_pin, LOW);
+  pinMode(cts_pin, INPUT_PULLUP);
+#endif
+
+  UCSR0A = _BV(U2X0); // Double speed mode for a more accurate 115200 baud at 16 MHz
+  UBRR0H = baud_setting >> 8;
+  UBRR0L = baud_setting;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00); // 8 data bits, no parity, 1 stop bit
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0); // Enable receiver, transmitter and receive interrupt
+}
+
+
+int modem_available() {
+  int count;
+
+  // The 16-bit buffer positions are changed by the interrupt, so read them with interrupts disabled
+  noInterrupts();
+  count = rx_count();
+  interrupts();
+
+  return count;
+}
+
+
+int modem_read() {
+  uint8_t c;
+
+  // Return -1 like Serial.read() when no data is waiting
+  if (modem_available() == 0)
+    return -1;
+
+  c = rx_buffer[rx_tail]; // Take the oldest byte from the buffer
+  noInterrupts();
+  rx_tail = (rx_tail + 1) & (RX_BUFFER_SIZE - 1);
+
+#if USE_FLOW_CONTROL
+  // Let the module send again once enough room has been freed
+  if (rx_paused && rx_count() <= RX_LOW_WATER) {
+    digitalWrite(rts_pin, LOW);
+    rx_paused = false;
+  }
+#endif
+
+  interrupts();
+
+  return c;
+}
+
+
+String modem_read_string() {
+  // Read with the same timeout as Serial.readString()
+  return modem_read_until_idle(RX_TIMEOUT);
+}
+
+
+String modem_read_until_idle(unsigned long idle) {
+  String data = ""; // String to store the received data
+  unsigned long tm = millis(); // Time the last byte was received
+
+  data.reserve(RX_BUFFER_SIZE); // Avoid reallocating the string for every byte
+
+  // Keep reading until no new byte has arrived for the given number of milliseconds
+  while (millis() - tm < idle) {
+    if (modem_available() > 0) {
+      data.concat(char(modem_read())); // Append the byte to the string
+      tm = millis(); // Restart the timeout
+    }
+  }
+
+  return data;
+}
+
+
+void modem_write(uint8_t c) {
+#if USE_FLOW_CONTROL
+  // Wait while the module asks us to stop sending, but never longer than CTS_TIMEOUT
+  if (tx_flow_enabled) {
+    unsigned long tm = millis();
+
+    // After a stall, wait for CTS again only once it has been seen LOW
+    if (tx_cts_stalled && digitalRead(cts_pin) == LOW)
+      tx_cts_stalled = false;
+
+    while (!tx_cts_stalled && digitalRead(cts_pin) == HIGH) {
+      if (millis() - tm >= CTS_TIMEOUT) {
+        tx_cts_timeouts++; // Count the stall once and send without waiting from now on
+        tx_cts_stalled = true;
+      }
+    }
+  }
+#endif
+
+  // Wait until the UART can accept another byte, then send it
+  while (!(UCSR0A & _BV(UDRE0))) {}
+  UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0); // Clear the transmit complete flag for modem_flush()
+  UDR0 = c;
+  tx_written = true;
+}
+
+
+void modem_print(const char* text) {
+  // Send each character of the text to the GSM module
+  while (*text)
+    modem_write(*text++);
+}
+
+
+void modem_print(const String& text) {
+  // Send the String without copying it
+  modem_print(text.c_str());
+}
+
+
+void modem_println(const char* text) {
+  // Send the text followed by a carriage return and line feed, like Serial.println()
+  modem_print(text);
+  modem_write('\r');
+  modem_write('\n');
+}
+
+
+void modem_println(const String& text) {
+  // Send the String followed by a carriage return and line feed, like Serial.println()
+  modem_print(text);
+  modem_write('\r');
+  modem_write('\n');
+}
+
+
+void modem_flush() {
+  // Nothing to wait for if no byte has been sent yet
+  if (!tx_written)
+    return;
+
+  // Wait until every byte has left the UART, like Serial.flush()
+  while (!(UCSR0A & _BV(UDRE0)) || !(UCSR0A & _BV(TXC0))) {}
+}
+
+
+String rx_stats() {
+  String stats = "RX OVF:"; // Text reporting the serial receive counters
+  unsigned long overflow, dropped, overrun, cts;
+
+  // Copy the counters with interrupts disabled so they are read consistently
+  noInterrupts();
+  overflow = rx_overflow_count;
+  dropped = rx_dropped_bytes;
+  overrun = rx_hw_overrun_events;
+  cts = tx_cts_timeouts;
+  interrupts();
+
+  stats = stats + overflow + " DROP:" + dropped + " HWOVR:" + overrun + " CTSTO:" + cts + " FC:" + (tx_flow_enabled ? "ON" : "OFF");
+  return stats;
+}
@@ -7,34 +7,145 @@
 // شامل کردن کتابخانه EEPROM برای خواندن و نوشتن در حافظه غیر فرار آردوینو (EEPROM)
 #include <EEPROM.h>
 
+// اندازه بافر حلقوی دریافت داده از ماژول GSM (باید توانی از دو باشد)
+// بافر ۶۴ بایتی پیش‌فرض برای نگه‌داشتن کامل پاسخ "AT+CMGR" یا مجموعه‌ای از URCها کافی نیست
+#define RX_BUFFER_SIZE 256
+
+// برای استفاده از کنترل جریان سخت‌افزاری RTS/CTS بین آردوینو و ماژول GSM مقدار ۱ قرار دهید
+#define USE_FLOW_CONTROL 0
+
+// RTS خروجی است (LOW = آردوینو آماده دریافت)، CTS ورودی است (LOW = ماژول آماده دریافت)
+#define rts_pin 2
+#define cts_pin 3
+
+// وقتی بافر تا این حد پر شود از ماژول خواسته می‌شود مکث کند و وقتی زیر RX_LOW_WATER برسد ادامه دهد
+#define RX_HIGH_WATER (RX_BUFFER_SIZE - 32)
+#define RX_LOW_WATER (RX_BUFFER_SIZE / 4)
+
+// موقعیت‌های بافر با "& (RX_BUFFER_SIZE - 1)" می‌چرخند و آستانه‌ها به فضا نیاز دارند، پس اندازه اینجا بررسی می‌شود
+#if (RX_BUFFER_SIZE & (RX_BUFFER_SIZE - 1)) || RX_BUFFER_SIZE < 64
+#error "RX_BUFFER_SIZE must be a power of two and at least 64"
+#endif
+
+// بیشترین زمان (میلی‌ثانیه) که modem_write() پیش از ارسال بایت منتظر CTS می‌ماند
+#define CTS_TIMEOUT 100
+
+// مدت زمان (میلی‌ثانیه) بدون دریافت بایت جدید که پس از آن modem_read_string() برمی‌گردد (مانند Serial.readString())
+#define RX_TIMEOUT 1000
+
+// مدت زمان (میلی‌ثانیه) بدون دریافت بایت جدید که خواندن در check_status_sms() را پایان می‌دهد، برای یک خط URC کافی است
+#define URC_TIMEOUT 100
+
+// بیشترین زمان (میلی‌ثانیه) که check_status_sms() منتظر پاسخ AT+CMGR می‌ماند
+#define CMGR_TIMEOUT 5000
+
+// تعداد دفعات ارسال AT+IFC=2,2 پیش از صرف‌نظر کردن از کنترل جریان سخت‌افزاری
+#define IFC_RETRIES 5
+
+// در بردهای ATmega328P نام وقفه دریافت USART_RX_vect و در بردهای چند UART برابر USART0_RX_vect است
+#if defined(USART_RX_vect)
+#define MODEM_RX_vect USART_RX_vect
+#else
+#define MODEM_RX_vect USART0_RX_vect
+#endif
+
+// بافر حلقوی دریافت که توسط وقفه UART پر و توسط modem_read() خالی می‌شود
+// از شیء Serial استفاده نمی‌شود زیرا وقفه خود آن با این وقفه تداخل دارد
+volatile uint8_t rx_buffer[RX_BUFFER_SIZE];
+volatile uint16_t rx_head = 0; // موقعیتی که وقفه بایت بعدی را در آن ذخیره می‌کند
+volatile uint16_t rx_tail = 0; // موقعیتی که modem_read() بایت بعدی را از آن برمی‌دارد
+
+// شمارنده‌های عیب‌یابی که توسط rx_stats() و دستور پیامکی "ST" گزارش می‌شوند
+volatile unsigned long rx_overflow_count = 0; // تعداد دفعاتی که بافر حلقوی پر شده است
+volatile unsigned long rx_dropped_bytes = 0; // تعداد بایت‌هایی که به دلیل پر بودن بافر دور ریخته شده‌اند
+volatile unsigned long rx_hw_overrun_events = 0; // تعداد رخدادهای سرریز داده UART که در هر کدام حداقل یک بایت پیش از اجرای وقفه از دست رفته است
+volatile bool rx_overflowed = false; // تا زمانی که بافر پر است true می‌ماند تا هر بار پر شدن فقط یک بار شمرده شود
+volatile bool rx_paused = false; // تا زمانی که RTS از ماژول خواسته ارسال را متوقف کند true است
+bool tx_flow_enabled = false; // پس از پذیرش AT+IFC=2,2 توسط ماژول true می‌شود و تنها از آن پس modem_write() منتظر CTS می‌ماند
+unsigned long tx_cts_timeouts = 0; // تعداد دفعاتی که CTS بیش از CTS_TIMEOUT در حالت HIGH مانده است
+bool tx_cts_stalled = false; // پس از گذشتن زمان CTS true می‌شود و modem_write() تا دیدن دوباره LOW روی CTS بدون انتظار ارسال می‌کند
+bool tx_written = false; // پس از ارسال اولین بایت true می‌شود تا modem_flush() چیزی برای انتظار داشته باشد
+
+
+int rx_count() {
+  // تعداد بایت‌های منتظر در بافر حلقوی (با وقفه‌های غیرفعال فراخوانی می‌شود)
+  return (rx_head - rx_tail) & (RX_BUFFER_SIZE - 1);
+}
+
+
+// برای هر بایت دریافتی از ماژول GSM اجرا می‌شود، حتی زمانی که برنامه در delay() است
+// فایل HardwareSerial0.cpp هسته آردوینو همین وقفه را تعریف می‌کند، پس هر استفاده از Serial در این برنامه
+// آن فایل را لینک کرده و با خطای تعریف تکراری USART_RX_vect مواجه می‌شود: به جای آن از توابع modem_* استفاده کنید
+ISR(MODEM_RX_vect) {
+  uint8_t status = UCSR0A; // خواندن وضعیت پیش از داده، زیرا خواندن UDR0 پرچم‌های خطا را پاک می‌کند
+  uint8_t c = UDR0; // برداشتن بایت دریافتی از UART
+  uint16_t next = (rx_head + 1) & (RX_BUFFER_SIZE - 1); // موقعیت نوشتن بعدی در بافر حلقوی
+
+  // شمارش رخدادهای سرریز UART که هر کدام یعنی حداقل یک بایت به دلیل خوانده نشدن به موقع بایت قبلی از دست رفته است
+  if (status & _BV(DOR0))
+    rx_hw_overrun_events++;
+
+  if (next == rx_tail) {
+    // بافر پر است: بایت دور ریخته می‌شود و پر شدن فقط یک بار در هر دوره شمرده می‌شود
+    rx_dropped_bytes++;
+    if (!rx_overflowed) {
+      rx_overflow_count++;
+      rx_overflowed = true;
+    }
+  } else {
+    rx_buffer[rx_head] = c; // ذخیره بایت
+    rx_head = next;
+    rx_overflowed = false;
+  }
+
+#if USE_FLOW_CONTROL
+  // درخواست توقف ارسال از ماژول پیش از پر شدن کامل بافر
+  if (!rx_paused && rx_count() >= RX_HIGH_WATER) {
+    digitalWrite(rts_pin, HIGH);
+    rx_paused = true;
+  }
+#endif
+}
+
 
 void setup() {
   int i = 0; // مقداردهی اولیه متغیر شمارنده
 
-  // شروع ارتباط سریال با نرخ بود 115200
-  Serial.begin(115200);
+  // شروع ارتباط سریال با ماژول GSM با نرخ بود 115200
+  modem_begin(115200);
 
   // فراخوانی تابعی برای بررسی و برقراری اتصال به شبکه GSM
   check_connect();
 
+#if USE_FLOW_CONTROL
+  // فعال کردن کنترل جریان سخت‌افزاری RTS/CTS در ماژول GSM اکنون که به دستورها پاسخ می‌دهد
+  // تکرار تا دریافت پاسخ OK، تنها پس از آن modem_write() منتظر CTS می‌ماند
+  for (int tries = 0; tries < IFC_RETRIES && !tx_flow_enabled; tries++) {
+    modem_print("AT+IFC=2,2\r\n");
+    delay(1000);
+    if (modem_read_string().indexOf("OK") >= 0)
+      tx_flow_enabled = true;
+  }
+#endif
+
   // تنظیم ماژول GSM برای کار در حالت پیامک متنی
-  Serial.print("AT+CMGF=1\r\n");
+  modem_print("AT+CMGF=1\r\n");
   delay(1000); // انتظار به مدت ۱ ثانیه برای اعمال دستور
 
   // حذف تمام پیامک‌های ذخیره شده در ماژول GSM
-  Serial.print("AT+CMGD=1,4\r\n");
+  modem_print("AT+CMGD=1,4\r\n");
   delay(1000);
 
   // تنظیم پارامترهای پیامک (مانند حالت PDU و دوره اعتبار)
-  Serial.print("AT+CSMP=17,167,0,0\r\n");
+  modem_print("AT+CSMP=17,167,0,0\r\n");
   delay(1000);
 
   // فعال کردن نمایش شماره تماس گیرنده
-  Serial.print("AT+CLIP=1\r\n");
+  modem_print("AT+CLIP=1\r\n");
   delay(1000);
 
   // پاک کردن داده‌های باقی‌مانده در بافر سریال
-  Serial.readString();
+  modem_read_string();
 
   // منتظر ماندن تا زمانی که حداقل یک شماره تلفن در EEPROM ذخیره شود
   // شماره‌ها در آدرس‌های 0 و 20 در EEPROM ذخیره می‌شوند
@@ -67,10 +178,10 @@ void setup() {
     delay(1000); // انتظار به مدت ۱ ثانیه (۳۰۰ ثانیه = ۵ دقیقه)
 
   // چاپ پیام به مانیتور سریال برای اعلام شروع پایش
-  Serial.println("MONITORING");
+  modem_println("MONITORING");
 
   // خالی کردن بافر سریال برای اطمینان از حذف داده‌های باقی‌مانده
-  Serial.flush();
+  modem_flush();
 }
 void loop() {
   // خواندن مقدار آنالوگ از حسگر گاز
@@ -83,31 +194,34 @@ void loop() {
     // بررسی تماس‌های ورودی در یک بازه زمانی مشخص
     // این کار به کاربر اجازه تعامل با سیستم را می‌دهد
     check_incoming_call();
+  } else {
+    // پاسخ به دستور وضعیت "ST" تنها زمانی که هشدار گاز وجود ندارد
+    check_status_sms();
   }
 }
 void check_connect() {
   String status_ = ""; // رشته‌ای برای ذخیره وضعیت پاسخ شبکه
 
   // اطلاع‌رسانی به کاربر که سیستم در حال انتظار برای اتصال به شبکه GSM است
-  Serial.println("WAITING TO CONNECT TO NETWORK");
+  modem_println("WAITING TO CONNECT TO NETWORK");
 
   // پاک کردن داده‌های باقی‌مانده در بافر سریال برای اطمینان از ارتباط تمیز
-  Serial.flush();
+  modem_flush();
 
   // بررسی پیوسته برای اتصال به شبکه
   while (true) {
     // اگر داده‌ای در بافر سریال وجود دارد، آن را بخوانید و نادیده بگیرید
-    if (Serial.available() > 0)
-      Serial.readString();
+    if (modem_available() > 0)
+      modem_read_string();
 
     // ارسال دستور AT برای بررسی وضعیت ثبت‌نام شبکه
-    Serial.print("AT+CCALR?\r\n");
+    modem_print("AT+CCALR?\r\n");
 
     // انتظار برای پاسخ ماژول GSM
     delay(1000);
 
     // خواندن پاسخ از ماژول GSM
-    status_ = Serial.readString();
+    status_ = modem_read_string();
 
     // بررسی اگر پاسخ نشان‌دهنده ثبت‌نام موفق در شبکه باشد
     // "+CCALR: 1" به معنای ثبت‌نام موفق در شبکه است
@@ -116,43 +230,45 @@ void check_connect() {
   }
 
   // چاپ پیام نشان‌دهنده اتصال موفق به شبکه
-  Serial.println("CONNECTED TO NETWORK");
+  modem_println("CONNECTED TO NETWORK");
 
   // دوباره پاک کردن بافر سریال برای اطمینان از حذف داده‌های باقی‌مانده
-  Serial.flush();
+  modem_flush();
 }
 void check_sms() {
   String get_sms = ""; // متغیری برای ذخیره محتوای پیامک دریافتی
 
   // بررسی اگر داده‌ای در بافر سریال موجود باشد
-  if (Serial.available() > 0)
-    get_sms = Serial.readString(); // خواندن داده‌های ورودی سریال به داخل رشته
+  if (modem_available() > 0)
+    get_sms = modem_read_string(); // خواندن داده‌های ورودی سریال به داخل رشته
 
   // بررسی اگر داده دریافتی شامل اعلان پیامک باشد (+CMTI)
   if (get_sms.indexOf("+CMTI") >= 0) {
     // پاک کردن داده‌های اضافی در بافر سریال
-    if (Serial.available() > 0)
-      Serial.readString();
+    if (modem_available() > 0)
+      modem_read_string();
 
     // ارسال دستور AT برای خواندن اولین پیامک موجود در صندوق ورودی
-    Serial.print("AT+CMGR=1\r\n");
+    modem_print("AT+CMGR=1\r\n");
 
     // انتظار تا زمانی که پاسخی از ماژول GSM دریافت شود
-    while (Serial.available() == 0) {}
+    while (modem_available() == 0) {}
 
     // خواندن محتوای پیامک از بافر سریال
-    get_sms = Serial.readString();
+    get_sms = modem_read_string();
 
     // استخراج محتوای اصلی پیامک با استفاده از جداکننده‌های '!' و '#'
     get_sms = get_sms.substring(get_sms.indexOf("!") + 1, get_sms.indexOf("#"));
 
     // ارسال دستور AT برای حذف تمام پیامک‌های موجود در صندوق ورودی جهت آزادسازی حافظه
-    Serial.print("AT+CMGD=1,4\r\n");
+    modem_print("AT+CMGD=1,4\r\n");
     delay(1000);
 
     // بررسی اگر محتوای پیامک یک دستور حذف باشد ("D1" یا "D2")
     if (get_sms == "D1" || get_sms == "D2")
       delete_number(get_sms); // حذف شماره متناظر از EEPROM
+    else if (get_sms == "ST")
+      send_sms(rx_stats()); // ارسال شمارنده‌های دریافت سریال اگر محتوا دستور وضعیت باشد
     else if (get_sms != "")
       save_number(get_sms); // ذخیره شماره جدید در EEPROM اگر محتوا معتبر باشد
   }
@@ -161,25 +277,25 @@ void check_connect() {
   String status_ = ""; // رشته‌ای برای ذخیره وضعیت پاسخ شبکه
 
   // اطلاع‌رسانی به کاربر که سیستم در حال انتظار برای اتصال به شبکه GSM است
-  Serial.println("WAITING TO CONNECT TO NETWORK");
+  modem_println("WAITING TO CONNECT TO NETWORK");
 
   // پاک کردن داده‌های باقی‌مانده در بافر سریال برای اطمینان از ارتباط تمیز
-  Serial.flush();
+  modem_flush();
 
   // بررسی پیوسته برای اتصال به شبکه
   while (true) {
     // اگر داده‌ای در بافر سریال وجود دارد، آن را بخوانید و نادیده بگیرید
-    if (Serial.available() > 0)
-      Serial.readString();
+    if (modem_available() > 0)
+      modem_read_string();
 
     // ارسال دستور AT برای بررسی وضعیت ثبت‌نام شبکه
-    Serial.print("AT+CCALR?\r\n");
+    modem_print("AT+CCALR?\r\n");
 
     // انتظار برای پاسخ ماژول GSM
     delay(1000);
 
     // خواندن پاسخ از ماژول GSM
-    status_ = Serial.readString();
+    status_ = modem_read_string();
 
     // بررسی اگر پاسخ نشان‌دهنده ثبت‌نام موفق در شبکه باشد
     // "+CCALR: 1" به معنای ثبت‌نام موفق در شبکه است
@@ -188,47 +304,81 @@ void check_connect() {
   }
 
   // چاپ پیام نشان‌دهنده اتصال موفق به شبکه
-  Serial.println("CONNECTED TO NETWORK");
+  modem_println("CONNECTED TO NETWORK");
 
   // دوباره پاک کردن بافر سریال برای اطمینان از حذف داده‌های باقی‌مانده
-  Serial.flush();
+  modem_flush();
 }
 void check_sms() {
   String get_sms = ""; // متغیری برای ذخیره محتوای پیامک دریافتی
 
   // بررسی اگر داده‌ای در بافر سریال موجود باشد
-  if (Serial.available() > 0)
-    get_sms = Serial.readString(); // خواندن داده‌های ورودی سریال به داخل رشته
+  if (modem_available() > 0)
+    get_sms = modem_read_string(); // خواندن داده‌های ورودی سریال به داخل رشته
 
   // بررسی اگر داده دریافتی شامل اعلان پیامک باشد (+CMTI)
   if (get_sms.indexOf("+CMTI") >= 0) {
     // پاک کردن داده‌های اضافی در بافر سریال
-    if (Serial.available() > 0)
-      Serial.readString();
+    if (modem_available() > 0)
+      modem_read_string();
 
     // ارسال دستور AT برای خواندن اولین پیامک موجود در صندوق ورودی
-    Serial.print("AT+CMGR=1\r\n");
+    modem_print("AT+CMGR=1\r\n");
 
     // انتظار تا زمانی که پاسخی از ماژول GSM دریافت شود
-    while (Serial.available() == 0) {}
+    while (modem_available() == 0) {}
 
     // خواندن محتوای پیامک از بافر سریال
-    get_sms = Serial.readString();
+    get_sms = modem_read_string();
 
     // استخراج محتوای اصلی پیامک با استفاده از جداکننده‌های '!' و '#'
     get_sms = get_sms.substring(get_sms.indexOf("!") + 1, get_sms.indexOf("#"));
 
     // ارسال دستور AT برای حذف تمام پیامک‌های موجود در صندوق ورودی جهت آزادسازی حافظه
-    Serial.print("AT+CMGD=1,4\r\n");
+    modem_print("AT+CMGD=1,4\r\n");
     delay(1000);
 
     // بررسی اگر محتوای پیامک یک دستور حذف باشد ("D1" یا "D2")
     if (get_sms == "D1" || get_sms == "D2")
       delete_number(get_sms); // حذف شماره متناظر از EEPROM
+    else if (get_sms == "ST")
+      send_sms(rx_stats()); // ارسال شمارنده‌های دریافت سریال اگر محتوا دستور وضعیت باشد
     else if (get_sms != "")
       save_number(get_sms); // ذخیره شماره جدید در EEPROM اگر محتوا معتبر باشد
   }
 }
+void check_status_sms() {
+  String get_sms = ""; // متغیری برای ذخیره محتوای پیامک دریافتی
+  unsigned long tm; // زمان ارسال دستور AT+CMGR
+
+  // اگر ماژول GSM چیزی نفرستاده بلافاصله برگرد تا حسگر گاز بدون تأخیر دوباره بررسی شود
+  if (modem_available() == 0)
+    return;
+
+  // خواندن داده‌های منتظر و نادیده گرفتن همه چیز به جز اعلان پیامک (+CMTI)
+  get_sms = modem_read_until_idle(URC_TIMEOUT);
+  if (get_sms.indexOf("+CMTI") < 0)
+    return;
+
+  // ارسال دستور AT برای خواندن اولین پیامک در صندوق ورودی
+  modem_print("AT+CMGR=1\r\n");
+
+  // انتظار برای پاسخ، اما نه بیشتر از CMGR_TIMEOUT
+  tm = millis();
+  while (modem_available() == 0 && millis() - tm < CMGR_TIMEOUT) {}
+
+  // خواندن پیامک و استخراج محتوای پیام بین '!' و '#'
+  get_sms = modem_read_until_idle(URC_TIMEOUT);
+  get_sms = get_sms.substring(get_sms.indexOf("!") + 1, get_sms.indexOf("#"));
+
+  // ارسال دستور AT برای حذف تمام پیامک‌های صندوق ورودی و آزاد کردن حافظه
+  modem_print("AT+CMGD=1,4\r\n");
+
+  // در طول پایش تنها به دستور وضعیت پاسخ داده می‌شود، شماره‌های ذخیره شده فقط هنگام راه‌اندازی قابل تغییرند
+  if (get_sms == "ST")
+    send_sms(rx_stats());
+}
+
 void save_number(String number) {
   int i = 0; // متغیری برای آدرس EEPROM
   int j = 0; // متغیری برای اندیس آرایه کاراکترها
@@ -267,11 +417,11 @@ void send_sms(String text) {
   if (char(EEPROM.read(0)) != NULL) {
     number = read_number(0); // خواندن شماره از اسلات اول (شروع از آدرس 0)
     cmgs = cmgs + number + "\"\r\n"; // تکمیل دستور ارسال پیامک با شماره
-    Serial.print(cmgs); // ارسال دستور به ماژول GSM
+    modem_print(cmgs); // ارسال دستور به ماژول GSM
     delay(500); // انتظار برای پردازش دستور
-    Serial.println(text); // ارسال محتوای پیامک
+    modem_println(text); // ارسال محتوای پیامک
     delay(500); // زمان برای انتقال محتوای پیامک
-    Serial.write(0x1a); // ارسال کاراکتر CTRL+Z (0x1A) برای پایان پیامک
+    modem_write(0x1a); // ارسال کاراکتر CTRL+Z (0x1A) برای پایان پیامک
     delay(15000); // انتظار برای ارسال موفق پیامک
   }
   // اگر اسلات اول خالی بود، بررسی اسلات دوم
@@ -279,10 +429,10 @@ void send_sms(String text) {
     cmgs = "AT+CMGS=\""; // تنظیم مجدد دستور پایه ارسال پیامک
     number = read_number(20); // خواندن شماره از اسلات دوم (شروع از آدرس 20)
     cmgs = cmgs + number + "\"\r\n"; // تکمیل دستور ارسال پیامک با شماره
-    Serial.print(cmgs); // ارسال دستور به ماژول GSM
+    modem_print(cmgs); // ارسال دستور به ماژول GSM
     delay(500); // انتظار برای پردازش دستور
-    Serial.println(text); // ارسال محتوای پیامک
-    Serial.write(0x1a); // ارسال کاراکتر CTRL+Z (0x1A) برای پایان پیامک
+    modem_println(text); // ارسال محتوای پیامک
+    modem_write(0x1a); // ارسال کاراکتر CTRL+Z (0x1A) برای پایان پیامک
   }
 }
 
@@ -323,14 +473,14 @@ void call_user() {
   // بررسی اگر شماره‌ای در اسلات اول EEPROM ذخیره شده باشد
   if (EEPROM.read(0) != NULL) {
     number = number + read_number(0) + ";\r\n"; // افزودن شماره ذخیره شده به دستور
-    Serial.print(number); // ارسال دستور AT به ماژول GSM برای برقراری تماس
+    modem_print(number); // ارسال دستور AT به ماژول GSM برای برقراری تماس
     delay(20000); // انتظار 20 ثانیه برای زنگ خوردن تماس
   }
 
   // بررسی اگر شماره‌ای در اسلات دوم EEPROM ذخیره شده باشد
   if (EEPROM.read(20) != NULL) {
     number = "ATD" + read_number(20) + ";\r\n"; // افزودن شماره ذخیره شده دوم به دستور
-    Serial.print(number); // ارسال دستور AT به ماژول GSM برای برقراری تماس
+    modem_print(number); // ارسال دستور AT به ماژول GSM برای برقراری تماس
     delay(20000); // انتظار 20 ثانیه برای زنگ خوردن تماس
   }
 }
@@ -342,8 +492,8 @@ void check_incoming_call() {
   // حلقه برای حداکثر مدت زمان 60 ثانیه برای بررسی تماس‌های ورودی
   while (millis() - tm < 60000) {
     // بررسی اگر داده‌ای از ماژول GSM در دسترس باشد
-    if (Serial.available() > 0) {
-      incoming_number = Serial.readString(); // خواندن داده‌های ورودی
+    if (modem_available() > 0) {
+      incoming_number = modem_read_string(); // خواندن داده‌های ورودی
     }
 
     // بررسی اگر داده‌های ورودی نشان‌دهنده تماس ورودی باشد ("RING")
@@ -359,8 +509,171 @@ void check_number(String data_to_parse) {
 
   // بررسی اگر شماره استخراج‌شده با یکی از شماره‌های ذخیره شده در EEPROM تطابق داشته باشد
   if (data_to_parse == read_number(0) || data_to_parse == read_number(20)) {
-    Serial.print("ATH\r\n"); // ارسال دستور "ATH" برای قطع تماس
+    modem_print("ATH\r\n"); // ارسال دستور "ATH" برای قطع تماس
     delay(500); // انتظار کوتاه برای پردازش دستور
     wdt_enable(WDTO_4S); // فعال‌سازی تایمر نگهبان با تایم‌اوت 4 ثانیه برای بازنشانی سیستم
   }
 }
+
+
+void modem_begin(unsigned long baud) {
+  // محاسبه تنظیم نرخ بود برای حالت سرعت دوبرابر، با گرد کردنی مشابه هسته آردوینو
+  uint16_t baud_setting = (F_CPU / 4 / baud - 1) / 2;
+
+#if USE_FLOW_CONTROL
+  // RTS در ابتدا LOW است تا ماژول بتواند ارسال کند، CTS پیش از ارسال هر بایت خوانده می‌شود
+  pinMode(rts_pin, OUTPUT);
+  digitalWrite(rts_pin, LOW);
+  pinMode(cts_pin, INPUT_PULLUP);
+#endif
+
+  UCSR0A = _BV(U2X0); // حالت سرعت دوبرابر برای دقت بیشتر نرخ 115200 در فرکانس ۱۶ مگاهرتز
+  UBRR0H = baud_setting >> 8;
+  UBRR0L = baud_setting;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00); // ۸ بیت داده، بدون بیت توازن، ۱ بیت توقف
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0); // فعال کردن گیرنده، فرستنده و وقفه دریافت
+}
+
+
+int modem_available() {
+  int count;
+
+  // موقعیت‌های ۱۶ بیتی بافر توسط وقفه تغییر می‌کنند، پس با وقفه‌های غیرفعال خوانده می‌شوند
+  noInterrupts();
+  count = rx_count();
+  interrupts();
+
+  return count;
+}
+
+
+int modem_read() {
+  uint8_t c;
+
+  // بازگرداندن -1 مانند Serial.read() در صورت نبود داده
+  if (modem_available() == 0)
+    return -1;
+
+  c = rx_buffer[rx_tail]; // برداشتن قدیمی‌ترین بایت از بافر
+  noInterrupts();
+  rx_tail = (rx_tail + 1) & (RX_BUFFER_SIZE - 1);
+
+#if USE_FLOW_CONTROL
+  // اجازه ارسال دوباره به ماژول پس از آزاد شدن فضای کافی
+  if (rx_paused && rx_count() <= RX_LOW_WATER) {
+    digitalWrite(rts_pin, LOW);
+    rx_paused = false;
+  }
+#endif
+
+  interrupts();
+
+  return c;
+}
+
+
+String modem_read_string() {
+  // خواندن با همان زمان انتظار Serial.readString()
+  return modem_read_until_idle(RX_TIMEOUT);
+}
+
+
+String modem_read_until_idle(unsigned long idle) {
+  String data = ""; // رشته‌ای برای ذخیره داده‌های دریافتی
+  unsigned long tm = millis(); // زمان دریافت آخرین بایت
+
+  data.reserve(RX_BUFFER_SIZE); // جلوگیری از تخصیص دوباره حافظه رشته برای هر بایت
+
+  // ادامه خواندن تا زمانی که به مدت میلی‌ثانیه‌های داده شده بایت جدیدی نرسد
+  while (millis() - tm < idle) {
+    if (modem_available() > 0) {
+      data.concat(char(modem_read())); // افزودن بایت به رشته
+      tm = millis(); // شروع دوباره زمان‌سنج
+    }
+  }
+
+  return data;
+}
+
+
+void modem_write(uint8_t c) {
+#if USE_FLOW_CONTROL
+  // انتظار تا زمانی که ماژول درخواست توقف ارسال دارد، اما نه بیشتر از CTS_TIMEOUT
+  if (tx_flow_enabled) {
+    unsigned long tm = millis();
+
+    // پس از یک توقف، انتظار برای CTS تنها پس از دیدن دوباره LOW از سر گرفته می‌شود
+    if (tx_cts_stalled && digitalRead(cts_pin) == LOW)
+      tx_cts_stalled = false;
+
+    while (!tx_cts_stalled && digitalRead(cts_pin) == HIGH) {
+      if (millis() - tm >= CTS_TIMEOUT) {
+        tx_cts_timeouts++; // شمارش یک‌باره توقف و ارسال بدون انتظار از این پس
+        tx_cts_stalled = true;
+      }
+    }
+  }
+#endif
+
+  // انتظار تا UART آماده پذیرش بایت بعدی شود، سپس ارسال آن
+  while (!(UCSR0A & _BV(UDRE0))) {}
+  UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0); // پاک کردن پرچم پایان ارسال برای modem_flush()
+  UDR0 = c;
+  tx_written = true;
+}
+
+
+void modem_print(const char* text) {
+  // ارسال تک‌تک کاراکترهای متن به ماژول GSM
+  while (*text)
+    modem_write(*text++);
+}
+
+
+void modem_print(const String& text) {
+  // ارسال رشته بدون کپی کردن آن
+  modem_print(text.c_str());
+}
+
+
+void modem_println(const char* text) {
+  // ارسال متن به همراه کاراکترهای بازگشت و خط جدید، مانند Serial.println()
+  modem_print(text);
+  modem_write('\r');
+  modem_write('\n');
+}
+
+
+void modem_println(const String& text) {
+  // ارسال رشته به همراه کاراکترهای بازگشت و خط جدید، مانند Serial.println()
+  modem_print(text);
+  modem_write('\r');
+  modem_write('\n');
+}
+
+
+void modem_flush() {
+  // اگر هنوز بایتی ارسال نشده چیزی برای انتظار وجود ندارد
+  if (!tx_written)
+    return;
+
+  // انتظار تا خروج کامل همه بایت‌ها از UART، مانند Serial.flush()
+  while (!(UCSR0A & _BV(UDRE0)) || !(UCSR0A & _BV(TXC0))) {}
+}
+
+
+String rx_stats() {
+  String stats = "RX OVF:"; // متن گزارش شمارنده‌های دریافت سریال
+  unsigned long overflow, dropped, overrun, cts;
+
+  // کپی شمارنده‌ها با وقفه‌های غیرفعال تا به صورت سازگار خوانده شوند
+  noInterrupts();
+  overflow = rx_overflow_count;
+  dropped = rx_dropped_bytes;
+  overrun = rx_hw_overrun_events;
+  cts = tx_cts_timeouts;
+  interrupts();
+
+  stats = stats + overflow + " DROP:" + dropped + " HWOVR:" + overrun + " CTSTO:" + cts + " FC:" + (tx_flow_enabled ? "ON" : "OFF");
+  return stats;
+}